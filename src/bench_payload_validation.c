@@ -0,0 +1,155 @@
+// bench_payload_validation.c - Throughput of the scalar vs SIMD payload validator
+//
+// Build: gcc -O2 -o bench_payload_validation src/bench_payload_validation.c
+// Usage: ./bench_payload_validation [payload_size] [total_megabytes]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "payload_validation.h"
+
+#define DEFAULT_PAYLOAD_SIZE 4091 // MAX_MESSAGE_SIZE - 5 byte header
+#define DEFAULT_TOTAL_MB 2048
+#define SELF_CHECK_ROUNDS 200000
+
+typedef int (*validator_fn)(const uint8_t *data, size_t len);
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// Fill buffer with printable ASCII chat text
+static void fill_ascii(uint8_t *buf, size_t len)
+{
+    const char *text = "Hello from the secure chat benchmark, how is everyone doing today? ";
+    size_t text_len = strlen(text);
+
+    for (size_t i = 0; i < len; i++)
+        buf[i] = (uint8_t)text[i % text_len];
+}
+
+
+// Fill buffer with mixed ASCII and 2/3/4-byte sequences, always ending on a code point boundary
+static void fill_mixed(uint8_t *buf, size_t len)
+{
+    static const char *pieces[] = { "chat ", "caf\xC3\xA9 ", "\xE4\xBD\xA0\xE5\xA5\xBD ", "\xF0\x9F\x98\x80 ", "ok " };
+    size_t i = 0, p = 0;
+
+    while (i < len) {
+        const char *piece = pieces[p++ % 5];
+        size_t n = strlen(piece);
+        if (i + n > len) {
+            memset(buf + i, 'x', len - i);
+            break;
+        }
+        memcpy(buf + i, piece, n);
+        i += n;
+    }
+}
+
+
+// Compare both implementations on random mutations of valid text
+static int self_check(size_t payload_size)
+{
+#if PAYLOAD_VALIDATION_SIMD
+    if (!payload_simd_available())
+        return 0;
+
+    uint8_t *buf = malloc(payload_size);
+    if (buf == NULL)
+        return -1;
+
+    srand(1);
+    for (int round = 0; round < SELF_CHECK_ROUNDS; round++) {
+        size_t len = (size_t)rand() % (payload_size < 96 ? payload_size : 96) + 1;
+        if (round & 1)
+            fill_mixed(buf, len);
+        else
+            fill_ascii(buf, len);
+
+        // flip a few random bytes to random values
+        int flips = rand() % 3;
+        for (int f = 0; f < flips; f++)
+            buf[rand() % len] = (uint8_t)rand();
+
+        if (payload_is_valid_scalar(buf, len) != payload_is_valid_ssse3(buf, len)) {
+            fprintf(stderr, "Mismatch on round %d (len %zu)\n", round, len);
+            free(buf);
+            return -1;
+        }
+    }
+
+    free(buf);
+#endif
+    (void)payload_size;
+    return 0;
+}
+
+
+static void run(const char *label, validator_fn fn, const uint8_t *buf, size_t payload_size, size_t total_bytes)
+{
+    size_t iterations = total_bytes / payload_size;
+    volatile int sink = 0;
+
+    // warm up caches and branch predictors
+    for (size_t i = 0; i < 1000; i++)
+        sink += fn(buf, payload_size);
+
+    double start = now_seconds();
+    for (size_t i = 0; i < iterations; i++)
+        sink += fn(buf, payload_size);
+    double elapsed = now_seconds() - start;
+
+    double gbps = (double)iterations * payload_size / elapsed / 1e9;
+    printf("  %-8s %8.3f GB/s  (%zu frames in %.3fs, accepted %d)\n", label, gbps, iterations, elapsed, sink > 0);
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t payload_size = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_PAYLOAD_SIZE;
+    size_t total_bytes = (argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_TOTAL_MB) * 1024UL * 1024UL;
+
+    if (payload_size == 0 || total_bytes < payload_size) {
+        fprintf(stderr, "Usage: %s [payload_size] [total_megabytes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (self_check(payload_size) != 0) {
+        fprintf(stderr, "Self-check failed: scalar and SIMD validators disagree\n");
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *buf = malloc(payload_size);
+    if (buf == NULL) {
+        perror("malloc failed");
+        return EXIT_FAILURE;
+    }
+
+    printf("Payload size: %zu bytes, %zu MB per run\n", payload_size, total_bytes / (1024UL * 1024UL));
+
+    printf("ASCII payload:\n");
+    fill_ascii(buf, payload_size);
+    run("scalar", payload_is_valid_scalar, buf, payload_size, total_bytes);
+#if PAYLOAD_VALIDATION_SIMD
+    if (payload_simd_available())
+        run("ssse3", payload_is_valid_ssse3, buf, payload_size, total_bytes);
+#endif
+
+    printf("Mixed UTF-8 payload:\n");
+    fill_mixed(buf, payload_size);
+    run("scalar", payload_is_valid_scalar, buf, payload_size, total_bytes);
+#if PAYLOAD_VALIDATION_SIMD
+    if (payload_simd_available())
+        run("ssse3", payload_is_valid_ssse3, buf, payload_size, total_bytes);
+#endif
+
+    free(buf);
+    return 0;
+}
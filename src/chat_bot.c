@@ -0,0 +1,178 @@
+// chat_bot.c - Drives many chat sessions from one thread using the async client library
+//
+// Each session waits for the server's welcome, sets a name, pipelines its
+// messages in one burst, and closes once the name has been acknowledged.
+//
+// Build: gcc -O2 -o chat_bot src/chat_bot.c src/chat_client.c
+// Usage: ./chat_bot [-n sessions] [-m messages_per_session] [-H host] [-p port]
+//
+// The stock server only has 10 client slots; build it with -DMAX_CLIENTS=n to go further.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "chat_client.h"
+
+#define DEFAULT_SESSIONS 10
+#define DEFAULT_MESSAGES 10
+#define DEFAULT_HOST "127.0.0.1"
+#define DEFAULT_PORT 8080
+
+typedef struct {
+    int id;
+    int messages;
+} bot_t;
+
+typedef struct {
+    size_t ready;
+    size_t oks;
+    size_t errors;
+    size_t messages_sent;
+    size_t messages_received;
+    size_t closed_clean;
+    size_t closed_error;
+} bot_stats_t;
+
+static bot_stats_t stats;
+
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void on_ready(chat_session_t *session, void *user)
+{
+    bot_t *bot = user;
+    char name[32];
+
+    stats.ready++;
+    snprintf(name, sizeof(name), "bot%d", bot->id);
+    chat_set_name(session, name);
+}
+
+
+static void on_ok(chat_session_t *session, const char *data, uint32_t length, void *user)
+{
+    bot_t *bot = user;
+    char text[64];
+    (void)data;
+    (void)length;
+
+    // name accepted: pipeline every message, they leave in a single send()
+    stats.oks++;
+    for (int i = 0; i < bot->messages; i++) {
+        snprintf(text, sizeof(text), "message %d from bot%d", i, bot->id);
+        if (chat_send_message(session, text) == 0)
+            stats.messages_sent++;
+    }
+    chat_session_close(session);
+}
+
+
+static void on_error(chat_session_t *session, const char *data, uint32_t length, void *user)
+{
+    bot_t *bot = user;
+
+    stats.errors++;
+    fprintf(stderr, "bot%d: server error: %.*s\n", bot->id, (int)length, data);
+    chat_session_close(session);
+}
+
+
+static void on_message(chat_session_t *session, const char *data, uint32_t length, void *user)
+{
+    (void)session;
+    (void)data;
+    (void)length;
+    (void)user;
+    stats.messages_received++;
+}
+
+
+static void on_close(chat_session_t *session, int error, void *user)
+{
+    bot_t *bot = user;
+    (void)session;
+
+    if (error == 0) {
+        stats.closed_clean++;
+    } else {
+        stats.closed_error++;
+        if (stats.closed_error <= 5)
+            fprintf(stderr, "bot%d: closed: %s\n", bot->id, strerror(error));
+    }
+}
+
+
+// Thousands of sessions need thousands of descriptors
+static void raise_fd_limit(size_t sessions)
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur >= sessions + 16)
+        return;
+
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t sessions = DEFAULT_SESSIONS;
+    int messages = DEFAULT_MESSAGES;
+    const char *host = DEFAULT_HOST;
+    int port = DEFAULT_PORT;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:H:p:")) != -1) {
+        switch (opt) {
+            case 'n': sessions = strtoul(optarg, NULL, 10); break;
+            case 'm': messages = atoi(optarg); break;
+            case 'H': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n sessions] [-m messages_per_session] [-H host] [-p port]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    raise_fd_limit(sessions);
+
+    chat_callbacks_t callbacks = { on_ready, on_ok, on_error, on_message, on_close };
+    chat_loop_t *loop = chat_loop_create();
+    bot_t *bots = calloc(sessions, sizeof(bot_t));
+    if (loop == NULL || bots == NULL) {
+        perror("allocation failed");
+        return EXIT_FAILURE;
+    }
+
+    double start = now_seconds();
+    for (size_t i = 0; i < sessions; i++) {
+        bots[i].id = (int)i;
+        bots[i].messages = messages;
+        if (chat_session_connect(loop, host, port, &callbacks, &bots[i]) == NULL) {
+            fprintf(stderr, "bot%zu: could not open connection\n", i);
+            stats.closed_error++;
+        }
+    }
+
+    int rc = chat_loop_run(loop);
+    double elapsed = now_seconds() - start;
+
+    printf("Sessions: %zu ready, %zu closed cleanly, %zu failed\n", stats.ready, stats.closed_clean, stats.closed_error);
+    printf("Replies:  %zu ok, %zu error\n", stats.oks, stats.errors);
+    printf("Messages: %zu sent, %zu received\n", stats.messages_sent, stats.messages_received);
+    printf("Elapsed:  %.3fs (%.0f messages sent/s)\n", elapsed, elapsed > 0 ? stats.messages_sent / elapsed : 0);
+
+    chat_loop_destroy(loop);
+    free(bots);
+    return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
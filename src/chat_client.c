@@ -0,0 +1,714 @@
+// chat_client.c - Asynchronous client library for the v1 TLV chat protocol (see chat_client.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "chat_client.h"
+#include "payload_validation.h"
+
+#define CHAT_HEADER_SIZE 5
+#define CHAT_INBOUND_BUFFER_SIZE (2 * (CHAT_HEADER_SIZE + CHAT_MAX_FRAME_PAYLOAD))
+
+struct chat_session {
+    chat_loop_t *loop;
+    int fd;
+    size_t slot; // index into loop->fds / loop->sessions
+
+    int connected;  // TCP handshake finished
+    int ready;      // welcome frame received
+    int closing;    // chat_session_close() was called
+    int write_shut; // SHUT_WR already sent
+    int dead;       // on_close has fired, freed at the end of the iteration
+
+    // MSG_OK/MSG_ERROR replies owed for frames queued so far, predicted with the server's rules
+    size_t replies_due;
+    int named; // a SET_NAME the server will accept has been queued
+
+    chat_callbacks_t callbacks;
+    void *user;
+
+    // pool membership (chat_pool_acquire)
+    chat_pool_t *pool;
+    size_t pool_slot;     // index into pool->members
+    int idle;             // released to the pool; callbacks suppressed
+    int name_pending;     // the pool's SET_NAME has not been answered yet
+    int registered;       // the server answered that SET_NAME with MSG_OK
+    uint64_t idle_since;  // release order, for evicting the longest-idle session
+    char name[CHAT_MAX_NAME + 1];
+
+    // queued outbound frames, sent from out_off
+    uint8_t *out;
+    size_t out_len, out_off, out_cap;
+
+    // inbound bytes not yet forming a complete frame
+    uint8_t in[CHAT_INBOUND_BUFFER_SIZE];
+    size_t in_len;
+};
+
+struct chat_loop {
+    struct pollfd *fds;
+    chat_session_t **sessions;
+    size_t count, cap;
+    size_t dead_count;
+    int stopped;
+};
+
+struct chat_pool {
+    chat_loop_t *loop;
+    char host[INET_ADDRSTRLEN];
+    int port;
+    chat_callbacks_t callbacks;
+    size_t max_idle;
+
+    // every live session acquired from this pool, idle or in use
+    chat_session_t **members;
+    size_t member_count, member_cap;
+    size_t idle_count;
+    uint64_t release_seq;
+};
+
+
+long chat_tlv_decode(const uint8_t *buf, size_t len, chat_frame_t *frame)
+{
+    if (len < CHAT_HEADER_SIZE)
+        return 0;
+
+    // Extract header fields manually to avoid struct alignment issues
+    uint32_t length = ((uint32_t)buf[1] << 24) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 8) | buf[4];
+    if (length > CHAT_MAX_FRAME_PAYLOAD)
+        return -1;
+
+    if (len < CHAT_HEADER_SIZE + (size_t)length)
+        return 0;
+
+    frame->type = buf[0];
+    frame->length = length;
+    frame->payload = buf + CHAT_HEADER_SIZE;
+    return (long)(CHAT_HEADER_SIZE + length);
+}
+
+
+chat_loop_t *chat_loop_create(void)
+{
+    return calloc(1, sizeof(chat_loop_t));
+}
+
+
+void chat_loop_destroy(chat_loop_t *loop)
+{
+    if (loop == NULL)
+        return;
+
+    for (size_t i = 0; i < loop->count; i++) {
+        chat_session_t *session = loop->sessions[i];
+        if (session->fd >= 0)
+            close(session->fd);
+        free(session->out);
+        free(session);
+    }
+
+    free(loop->fds);
+    free(loop->sessions);
+    free(loop);
+}
+
+
+size_t chat_loop_session_count(const chat_loop_t *loop)
+{
+    return loop->count - loop->dead_count;
+}
+
+
+void chat_loop_stop(chat_loop_t *loop)
+{
+    loop->stopped = 1;
+}
+
+
+void *chat_session_user(const chat_session_t *session)
+{
+    return session->user;
+}
+
+
+size_t chat_session_pending_output(const chat_session_t *session)
+{
+    return session->out_len - session->out_off;
+}
+
+
+size_t chat_session_pending_replies(const chat_session_t *session)
+{
+    return session->replies_due;
+}
+
+
+// Mirror of the server's reply rules in handle_client_message(): SET_NAME and
+// unknown types are always answered, SEND_MESSAGE only when it is refused
+static int expects_reply(chat_session_t *session, uint8_t type, const void *data, uint32_t length)
+{
+    if (type != CHAT_MSG_SET_NAME && type != CHAT_MSG_SEND_MESSAGE)
+        return 1;
+
+    if (!payload_is_valid(data, length))
+        return 1;
+
+    if (type == CHAT_MSG_SET_NAME) {
+        if (length > 0 && length <= CHAT_MAX_NAME)
+            session->named = 1;
+        return 1;
+    }
+
+    return !session->named; // "Set name first"
+}
+
+
+static void pool_remove(chat_session_t *session)
+{
+    chat_pool_t *pool = session->pool;
+
+    pool->members[session->pool_slot] = pool->members[--pool->member_count];
+    pool->members[session->pool_slot]->pool_slot = session->pool_slot;
+    if (session->idle)
+        pool->idle_count--;
+    session->pool = NULL;
+}
+
+
+// Tear the session down and report it. Memory is reclaimed by the loop later,
+// so callers further up the stack may still look at the (dead) session.
+static void session_finish(chat_session_t *session, int error)
+{
+    if (session->dead)
+        return;
+
+    close(session->fd);
+    session->fd = -1;
+    session->dead = 1;
+
+    chat_loop_t *loop = session->loop;
+    loop->fds[session->slot].fd = -1; // poll() skips negative fds
+    loop->dead_count++;
+
+    if (session->pool != NULL)
+        pool_remove(session);
+
+    // an idle pooled session belongs to nobody, so there is no one to tell
+    if (!session->idle && session->callbacks.on_close)
+        session->callbacks.on_close(session, error, session->user);
+}
+
+
+static void session_flush(chat_session_t *session)
+{
+    while (session->out_off < session->out_len) {
+        ssize_t n = send(session->fd, session->out + session->out_off, session->out_len - session->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return; // wait for POLLOUT
+            if (errno == EINTR)
+                continue;
+            session_finish(session, errno);
+            return;
+        }
+        session->out_off += (size_t)n;
+    }
+
+    session->out_len = session->out_off = 0;
+
+    // everything the user queued before closing has left; tell the server we're done
+    if (session->closing && !session->write_shut) {
+        shutdown(session->fd, SHUT_WR);
+        session->write_shut = 1;
+    }
+}
+
+
+static void session_dispatch(chat_session_t *session, const chat_frame_t *frame)
+{
+    const chat_callbacks_t *cb = &session->callbacks;
+    const char *data = (const char *)frame->payload;
+
+    if (frame->type == CHAT_MSG_OK || frame->type == CHAT_MSG_ERROR) {
+        if (session->replies_due > 0)
+            session->replies_due--;
+
+        // on a pooled session the first reply answers the SET_NAME chat_pool_acquire() queued
+        if (session->name_pending) {
+            session->name_pending = 0;
+            session->registered = frame->type == CHAT_MSG_OK;
+        }
+    }
+
+    // idle pooled sessions still drain broadcasts, but nobody is listening.
+    // chat_pool_release() never idles a session that is owed a reply.
+    if (session->idle) {
+        if (frame->type == CHAT_MSG_SEND_MESSAGE)
+            session->ready = 1;
+        return;
+    }
+
+    switch (frame->type) {
+        case CHAT_MSG_OK:
+            if (cb->on_ok)
+                cb->on_ok(session, data, frame->length, session->user);
+            break;
+
+        case CHAT_MSG_ERROR:
+            if (cb->on_error)
+                cb->on_error(session, data, frame->length, session->user);
+            break;
+
+        case CHAT_MSG_SEND_MESSAGE:
+            // the server's first frame on a connection is its welcome
+            if (!session->ready) {
+                session->ready = 1;
+                if (cb->on_ready)
+                    cb->on_ready(session, session->user);
+            } else if (cb->on_message) {
+                cb->on_message(session, data, frame->length, session->user);
+            }
+            break;
+
+        default:
+            break; // unknown frame types are ignored
+    }
+}
+
+
+static void session_read(chat_session_t *session)
+{
+    while (!session->dead) {
+        ssize_t n = recv(session->fd, session->in + session->in_len, sizeof(session->in) - session->in_len, 0);
+
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            if (errno == EINTR)
+                continue;
+            session_finish(session, errno);
+            return;
+        }
+
+        if (n == 0) {
+            // server hung up: expected after our half-close, otherwise a refusal (server full) or a drop
+            if (session->write_shut)
+                session_finish(session, 0);
+            else
+                session_finish(session, session->ready ? ECONNRESET : ECONNREFUSED);
+            return;
+        }
+
+        session->in_len += (size_t)n;
+
+        // decode every complete frame in the buffer
+        size_t off = 0;
+        chat_frame_t frame;
+        long consumed;
+        while (!session->dead && (consumed = chat_tlv_decode(session->in + off, session->in_len - off, &frame)) > 0) {
+            session_dispatch(session, &frame);
+            off += (size_t)consumed;
+        }
+
+        if (session->dead)
+            return;
+        if (consumed < 0) {
+            session_finish(session, EPROTO);
+            return;
+        }
+
+        memmove(session->in, session->in + off, session->in_len - off);
+        session->in_len -= off;
+    }
+}
+
+
+static int loop_add(chat_loop_t *loop, chat_session_t *session)
+{
+    if (loop->count == loop->cap) {
+        size_t new_cap = loop->cap ? loop->cap * 2 : 64;
+        struct pollfd *fds = realloc(loop->fds, new_cap * sizeof(*fds));
+        if (fds == NULL)
+            return -1;
+        loop->fds = fds;
+
+        chat_session_t **sessions = realloc(loop->sessions, new_cap * sizeof(*sessions));
+        if (sessions == NULL)
+            return -1;
+        loop->sessions = sessions;
+        loop->cap = new_cap;
+    }
+
+    session->slot = loop->count;
+    loop->sessions[loop->count] = session;
+    loop->fds[loop->count].fd = session->fd;
+    loop->fds[loop->count].events = POLLIN | POLLOUT;
+    loop->fds[loop->count].revents = 0;
+    loop->count++;
+    return 0;
+}
+
+
+// Free dead sessions and close the gaps they leave in the poll set
+static void loop_compact(chat_loop_t *loop)
+{
+    size_t kept = 0;
+
+    if (loop->dead_count == 0)
+        return;
+
+    for (size_t i = 0; i < loop->count; i++) {
+        chat_session_t *session = loop->sessions[i];
+        if (session->dead) {
+            free(session->out);
+            free(session);
+            continue;
+        }
+
+        session->slot = kept;
+        loop->sessions[kept] = session;
+        loop->fds[kept] = loop->fds[i];
+        kept++;
+    }
+
+    loop->count = kept;
+    loop->dead_count = 0;
+}
+
+
+chat_session_t *chat_session_connect(chat_loop_t *loop, const char *host, int port,
+                                     const chat_callbacks_t *callbacks, void *user)
+{
+    struct sockaddr_in address;
+    int opt = 1;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &address.sin_addr) != 1)
+        return NULL;
+
+    chat_session_t *session = calloc(1, sizeof(*session));
+    if (session == NULL)
+        return NULL;
+
+    session->loop = loop;
+    session->user = user;
+    if (callbacks != NULL)
+        session->callbacks = *callbacks;
+
+    if ((session->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        free(session);
+        return NULL;
+    }
+
+    // frames are already coalesced per loop iteration, so don't let Nagle delay them further
+    setsockopt(session->fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    fcntl(session->fd, F_SETFL, fcntl(session->fd, F_GETFL, 0) | O_NONBLOCK);
+
+    if (connect(session->fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+        session->connected = 1;
+    } else if (errno != EINPROGRESS) {
+        close(session->fd);
+        free(session);
+        return NULL;
+    }
+
+    if (loop_add(loop, session) != 0) {
+        close(session->fd);
+        free(session);
+        return NULL;
+    }
+
+    return session;
+}
+
+
+int chat_session_send(chat_session_t *session, uint8_t type, const void *data, uint32_t length)
+{
+    if (session->dead || session->closing || length > CHAT_MAX_FRAME_PAYLOAD)
+        return -1;
+
+    size_t pending = session->out_len - session->out_off;
+    size_t frame_len = CHAT_HEADER_SIZE + (size_t)length;
+    if (pending + frame_len > CHAT_MAX_PENDING_OUTPUT)
+        return -1;
+
+    // reclaim the already-sent prefix before growing
+    if (session->out_off > 0) {
+        memmove(session->out, session->out + session->out_off, pending);
+        session->out_len = pending;
+        session->out_off = 0;
+    }
+
+    if (session->out_len + frame_len > session->out_cap) {
+        size_t new_cap = session->out_cap ? session->out_cap : 1024;
+        while (new_cap < session->out_len + frame_len)
+            new_cap *= 2;
+
+        uint8_t *out = realloc(session->out, new_cap);
+        if (out == NULL)
+            return -1;
+        session->out = out;
+        session->out_cap = new_cap;
+    }
+
+    uint8_t *header = session->out + session->out_len;
+    header[0] = type;
+    header[1] = (length >> 24) & 0xFF; // highest byte first (network order)
+    header[2] = (length >> 16) & 0xFF;
+    header[3] = (length >> 8) & 0xFF;
+    header[4] = length & 0xFF;
+    if (length > 0)
+        memcpy(header + CHAT_HEADER_SIZE, data, length);
+    session->out_len += frame_len;
+
+    if (expects_reply(session, type, data, length))
+        session->replies_due++;
+
+    return 0;
+}
+
+
+int chat_set_name(chat_session_t *session, const char *name)
+{
+    return chat_session_send(session, CHAT_MSG_SET_NAME, name, (uint32_t)strlen(name));
+}
+
+
+int chat_send_message(chat_session_t *session, const char *text)
+{
+    return chat_session_send(session, CHAT_MSG_SEND_MESSAGE, text, (uint32_t)strlen(text));
+}
+
+
+void chat_session_close(chat_session_t *session)
+{
+    if (session->dead || session->closing)
+        return;
+
+    session->closing = 1;
+
+    // nothing queued: half-close now, otherwise session_flush() does it once the queue drains
+    if (session->connected && session->out_off == session->out_len) {
+        shutdown(session->fd, SHUT_WR);
+        session->write_shut = 1;
+    }
+}
+
+
+int chat_loop_run_once(chat_loop_t *loop, int timeout_ms)
+{
+    // coalesced write pass: one send() per session for everything queued since the last iteration
+    for (size_t i = 0; i < loop->count; i++) {
+        chat_session_t *session = loop->sessions[i];
+        if (!session->dead && session->connected)
+            session_flush(session);
+    }
+
+    // callbacks may have run (on_close) and queued more work; don't block in that case
+    for (size_t i = 0; i < loop->count; i++) {
+        chat_session_t *session = loop->sessions[i];
+        if (session->dead)
+            continue;
+
+        int want_write = !session->connected || session->out_off < session->out_len;
+        loop->fds[i].events = POLLIN | (want_write ? POLLOUT : 0);
+        loop->fds[i].revents = 0;
+    }
+
+    loop_compact(loop);
+    if (loop->count == 0)
+        return 0;
+
+    size_t polled = loop->count;
+    if (poll(loop->fds, polled, timeout_ms) < 0) {
+        if (errno == EINTR)
+            return 0;
+        return -1;
+    }
+
+    // sessions opened by callbacks land past `polled` and are picked up next iteration
+    for (size_t i = 0; i < polled; i++) {
+        chat_session_t *session = loop->sessions[i];
+        short revents = loop->fds[i].revents;
+
+        if (session->dead || revents == 0)
+            continue;
+
+        if (!session->connected) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+
+            getsockopt(session->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+            if (error != 0) {
+                session_finish(session, error);
+                continue;
+            }
+
+            session->connected = 1;
+            if (session->closing && session->out_off == session->out_len) {
+                shutdown(session->fd, SHUT_WR);
+                session->write_shut = 1;
+            }
+        }
+
+        if (revents & POLLOUT)
+            session_flush(session);
+        if (!session->dead && (revents & (POLLIN | POLLHUP | POLLERR)))
+            session_read(session);
+    }
+
+    loop_compact(loop);
+    return 0;
+}
+
+
+int chat_loop_run(chat_loop_t *loop)
+{
+    loop->stopped = 0;
+
+    while (!loop->stopped && chat_loop_session_count(loop) > 0) {
+        if (chat_loop_run_once(loop, -1) != 0) {
+            perror("poll failed");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+chat_pool_t *chat_pool_create(chat_loop_t *loop, const char *host, int port,
+                              const chat_callbacks_t *callbacks, size_t max_idle)
+{
+    struct in_addr addr;
+
+    if (strlen(host) >= INET_ADDRSTRLEN || inet_pton(AF_INET, host, &addr) != 1)
+        return NULL;
+
+    chat_pool_t *pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+
+    pool->loop = loop;
+    strcpy(pool->host, host);
+    pool->port = port;
+    pool->max_idle = max_idle;
+    if (callbacks != NULL)
+        pool->callbacks = *callbacks;
+
+    return pool;
+}
+
+
+chat_session_t *chat_pool_acquire(chat_pool_t *pool, const char *name, void *user)
+{
+    // refuse up front what the server would answer with MSG_ERROR
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > CHAT_MAX_NAME || !payload_is_valid((const uint8_t *)name, name_len))
+        return NULL;
+
+    // reuse an idle session that is already registered under this name
+    for (size_t i = 0; i < pool->member_count; i++) {
+        chat_session_t *session = pool->members[i];
+        if (session->idle && session->registered && strcmp(session->name, name) == 0) {
+            session->idle = 0;
+            session->user = user;
+            pool->idle_count--;
+            return session;
+        }
+    }
+
+    if (pool->member_count == pool->member_cap) {
+        size_t new_cap = pool->member_cap ? pool->member_cap * 2 : 64;
+        chat_session_t **members = realloc(pool->members, new_cap * sizeof(*members));
+        if (members == NULL)
+            return NULL;
+        pool->members = members;
+        pool->member_cap = new_cap;
+    }
+
+    chat_session_t *session = chat_session_connect(pool->loop, pool->host, pool->port, &pool->callbacks, user);
+    if (session == NULL)
+        return NULL;
+
+    // SET_NAME goes out ahead of anything the caller queues next
+    memcpy(session->name, name, name_len + 1);
+    chat_set_name(session, name);
+    session->name_pending = 1;
+
+    session->pool = pool;
+    session->pool_slot = pool->member_count;
+    pool->members[pool->member_count++] = session;
+    return session;
+}
+
+
+void chat_pool_release(chat_session_t *session)
+{
+    chat_pool_t *pool = session->pool;
+
+    if (session->dead || session->idle)
+        return;
+    if (pool == NULL || session->closing) {
+        chat_session_close(session);
+        return;
+    }
+
+    // only a session the server has accepted the name for can be handed out again,
+    // and only once it owes nothing: replies dropped while idle would otherwise
+    // be matched against the next holder's frames
+    if (pool->max_idle == 0 || !session->registered || session->replies_due > 0 || chat_session_pending_output(session) != 0) {
+        chat_session_close(session);
+        return;
+    }
+
+    // make room by closing the session that has been idle longest
+    if (pool->idle_count >= pool->max_idle) {
+        chat_session_t *oldest = NULL;
+        for (size_t i = 0; i < pool->member_count; i++) {
+            chat_session_t *member = pool->members[i];
+            if (member->idle && (oldest == NULL || member->idle_since < oldest->idle_since))
+                oldest = member;
+        }
+        chat_session_close(oldest);
+        pool_remove(oldest);
+    }
+
+    session->idle = 1;
+    session->idle_since = pool->release_seq++;
+    session->user = NULL;
+    pool->idle_count++;
+}
+
+
+size_t chat_pool_idle_count(const chat_pool_t *pool)
+{
+    return pool->idle_count;
+}
+
+
+void chat_pool_destroy(chat_pool_t *pool)
+{
+    if (pool == NULL)
+        return;
+
+    for (size_t i = 0; i < pool->member_count; i++) {
+        chat_session_t *session = pool->members[i];
+        session->pool = NULL;
+        if (session->idle)
+            chat_session_close(session);
+    }
+
+    free(pool->members);
+    free(pool);
+}
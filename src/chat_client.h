@@ -0,0 +1,149 @@
+// chat_client.h - Asynchronous client library for the v1 TLV chat protocol
+//
+// One chat_loop_t multiplexes any number of chat sessions on a single thread
+// with non-blocking sockets and poll(). Outgoing frames are queued per session
+// and pipelined: everything queued between two loop iterations goes out in a
+// single send(), so a burst of chat_send_message() calls costs one syscall.
+// Inbound bytes are run through a streaming TLV decoder and dispatched to
+// per-session callbacks.
+//
+// Connection pooling is keyed by chat name: the server binds a name to the
+// connection that set it, so an arbitrary pooled connection cannot be handed
+// to a different user. chat_pool_t keeps released sessions connected and
+// registered, and chat_pool_acquire() reuses one with the requested name
+// instead of reconnecting and re-sending SET_NAME.
+//
+// Typical use:
+//   chat_loop_t *loop = chat_loop_create();
+//   chat_session_connect(loop, "127.0.0.1", 8080, &callbacks, user_data);
+//   chat_loop_run(loop);            // returns when every session has closed
+//   chat_loop_destroy(loop);
+//
+// Build: gcc -O2 -o my_bot my_bot.c src/chat_client.c
+#ifndef CHAT_CLIENT_H
+#define CHAT_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHAT_MAX_FRAME_PAYLOAD 4091     // server's MAX_MESSAGE_SIZE minus the 5 byte header
+#define CHAT_MAX_PENDING_OUTPUT (1024 * 1024) // per-session cap on queued, unsent bytes
+#define CHAT_MAX_NAME 30 // longest name the server accepts (MAX_NAME_SIZE - 1)
+
+// TLV Protocol Constants, prefixed so programs that declare their own
+// MSG_* / message_type_t (as every tool in src/ does) can include this header
+typedef enum {
+    CHAT_MSG_SET_NAME = 0x01,
+    CHAT_MSG_SEND_MESSAGE = 0x02,
+    CHAT_MSG_ERROR = 0x03,
+    CHAT_MSG_OK = 0x04
+} chat_message_type_t;
+
+typedef struct chat_loop chat_loop_t;
+typedef struct chat_session chat_session_t;
+typedef struct chat_pool chat_pool_t;
+
+// One decoded frame; payload points into the caller's buffer and is not NUL-terminated
+typedef struct {
+    uint8_t type;
+    uint32_t length;
+    const uint8_t *payload;
+} chat_frame_t;
+
+// Callbacks may be NULL. They run on the loop thread and may queue sends,
+// open new sessions, or close any session (including their own).
+typedef struct {
+    // server greeted the session: it holds a slot and will accept frames
+    void (*on_ready)(chat_session_t *session, void *user);
+    // CHAT_MSG_OK reply to an earlier frame
+    void (*on_ok)(chat_session_t *session, const char *data, uint32_t length, void *user);
+    // CHAT_MSG_ERROR reply to an earlier frame
+    void (*on_error)(chat_session_t *session, const char *data, uint32_t length, void *user);
+    // broadcast chat message from another client
+    void (*on_message)(chat_session_t *session, const char *data, uint32_t length, void *user);
+    // session is gone; error is 0 for a clean close, otherwise an errno value.
+    // The session pointer is invalid once this returns.
+    void (*on_close)(chat_session_t *session, int error, void *user);
+} chat_callbacks_t;
+
+
+// Streaming TLV decoder: decode one frame from the front of buf.
+// Returns the number of bytes consumed (> 0), 0 if more data is needed,
+// or -1 if the declared length exceeds CHAT_MAX_FRAME_PAYLOAD.
+long chat_tlv_decode(const uint8_t *buf, size_t len, chat_frame_t *frame);
+
+
+// Returns NULL on allocation failure
+chat_loop_t *chat_loop_create(void);
+
+// Closes any remaining sessions without invoking callbacks
+void chat_loop_destroy(chat_loop_t *loop);
+
+// Run one iteration: flush queued output, wait up to timeout_ms (-1 = forever)
+// for socket activity, and dispatch callbacks. Returns 0, or -1 if poll() failed.
+int chat_loop_run_once(chat_loop_t *loop, int timeout_ms);
+
+// Run until every session has closed or chat_loop_stop() is called. Returns 0, or -1 on error.
+int chat_loop_run(chat_loop_t *loop);
+
+// Make chat_loop_run() return after the current iteration
+void chat_loop_stop(chat_loop_t *loop);
+
+size_t chat_loop_session_count(const chat_loop_t *loop);
+
+
+// Start a non-blocking connect to host (numeric IPv4) and port.
+// Frames may be queued immediately; they are sent once the connection is up.
+// Returns NULL if the socket could not be created or the address is invalid.
+chat_session_t *chat_session_connect(chat_loop_t *loop, const char *host, int port,
+                                     const chat_callbacks_t *callbacks, void *user);
+
+// Queue one TLV frame. Returns 0, or -1 if the session is closing, the payload
+// is too large, or CHAT_MAX_PENDING_OUTPUT would be exceeded (back-pressure).
+int chat_session_send(chat_session_t *session, uint8_t type, const void *data, uint32_t length);
+
+// Convenience wrappers around chat_session_send() for NUL-terminated strings
+int chat_set_name(chat_session_t *session, const char *name);
+int chat_send_message(chat_session_t *session, const char *text);
+
+// Graceful close: flush queued frames, half-close, and wait for the server to
+// hang up so in-flight replies are still delivered. on_close fires at the end.
+void chat_session_close(chat_session_t *session);
+
+void *chat_session_user(const chat_session_t *session);
+size_t chat_session_pending_output(const chat_session_t *session);
+
+// MSG_OK/MSG_ERROR replies the server still owes for frames queued so far.
+// Only frames the server answers count: SET_NAME, unknown types, and refused
+// SEND_MESSAGE frames; an accepted chat message gets no reply.
+size_t chat_session_pending_replies(const chat_session_t *session);
+
+
+// Pool of named sessions to one server, sharing one set of callbacks.
+// At most max_idle released sessions are kept; beyond that the longest-idle
+// one is closed. Returns NULL on allocation failure or an invalid host.
+chat_pool_t *chat_pool_create(chat_loop_t *loop, const char *host, int port,
+                              const chat_callbacks_t *callbacks, size_t max_idle);
+
+// Get a session registered as `name` (1..CHAT_MAX_NAME bytes of printable UTF-8)
+// with `user` as its callback argument. An idle session with that name is reused
+// as-is; otherwise a new connection is opened with SET_NAME queued, and its
+// MSG_OK/MSG_ERROR reaches on_ok/on_error. Either way frames can be queued
+// immediately. Returns NULL if the server would refuse the name or the
+// connection could not be started.
+chat_session_t *chat_pool_acquire(chat_pool_t *pool, const char *name, void *user);
+
+// Hand a session back to its pool. It stays connected; while idle its callbacks
+// are suppressed, and if it is closed by the server it simply leaves the pool.
+// Sessions that are closing, whose pool is gone, or whose SET_NAME has not been
+// answered with MSG_OK are closed instead. So are sessions with queued output or
+// outstanding replies (chat_session_pending_replies()): wait for both to reach
+// zero before releasing if the connection should be kept.
+void chat_pool_release(chat_session_t *session);
+
+size_t chat_pool_idle_count(const chat_pool_t *pool);
+
+// Close idle sessions and detach in-use ones (releasing them later closes them)
+void chat_pool_destroy(chat_pool_t *pool);
+
+#endif // CHAT_CLIENT_H
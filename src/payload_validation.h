@@ -0,0 +1,269 @@
+// payload_validation.h - UTF-8 validation and control-character filtering for TLV payloads
+//
+// Every MSG_SET_NAME / MSG_SEND_MESSAGE payload is checked once, on its
+// declared TLV length (never strlen()), before the server touches it.
+// A payload is accepted only if it is well-formed UTF-8 and contains no
+// control characters (C0, DEL, C1) and no embedded NUL bytes, which closes
+// the truncation / newline-spoofing tricks from docs/exploits/.
+//
+// Header-only so the single-file programs in src/ can include it directly.
+#ifndef PAYLOAD_VALIDATION_H
+#define PAYLOAD_VALIDATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <tmmintrin.h>
+#define PAYLOAD_VALIDATION_SIMD 1
+#else
+#define PAYLOAD_VALIDATION_SIMD 0
+#endif
+
+// Decode and check one UTF-8 sequence starting at data[i].
+// Returns the sequence length (1-4) or 0 if it is malformed or a control character.
+static inline size_t payload_check_sequence(const uint8_t *data, size_t len, size_t i)
+{
+    uint8_t c = data[i];
+
+    // ASCII: reject C0 controls (including NUL, '\n', '\r') and DEL
+    if (c < 0x80) {
+        return (c >= 0x20 && c != 0x7F) ? 1 : 0;
+    }
+
+    // Two-byte sequence: C2..DF, no overlongs (C0/C1)
+    if (c >= 0xC2 && c <= 0xDF) {
+        if (i + 1 >= len || (data[i + 1] & 0xC0) != 0x80)
+            return 0;
+        // U+0080..U+009F are C1 control characters
+        if (c == 0xC2 && data[i + 1] < 0xA0)
+            return 0;
+        return 2;
+    }
+
+    // Three-byte sequence: E0..EF, no overlongs, no UTF-16 surrogates
+    if (c >= 0xE0 && c <= 0xEF) {
+        if (i + 2 >= len)
+            return 0;
+        uint8_t c1 = data[i + 1];
+        uint8_t lo = (c == 0xE0) ? 0xA0 : 0x80;
+        uint8_t hi = (c == 0xED) ? 0x9F : 0xBF;
+        if (c1 < lo || c1 > hi || (data[i + 2] & 0xC0) != 0x80)
+            return 0;
+        return 3;
+    }
+
+    // Four-byte sequence: F0..F4, no overlongs, nothing above U+10FFFF
+    if (c >= 0xF0 && c <= 0xF4) {
+        if (i + 3 >= len)
+            return 0;
+        uint8_t c1 = data[i + 1];
+        uint8_t lo = (c == 0xF0) ? 0x90 : 0x80;
+        uint8_t hi = (c == 0xF4) ? 0x8F : 0xBF;
+        if (c1 < lo || c1 > hi || (data[i + 2] & 0xC0) != 0x80 || (data[i + 3] & 0xC0) != 0x80)
+            return 0;
+        return 4;
+    }
+
+    // Stray continuation byte or invalid lead byte (C0, C1, F5..FF)
+    return 0;
+}
+
+
+// Scalar reference implementation, one code point at a time.
+// Returns 1 if the payload is acceptable, 0 otherwise.
+static inline int payload_is_valid_scalar(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len) {
+        size_t n = payload_check_sequence(data, len, i);
+        if (n == 0)
+            return 0;
+        i += n;
+    }
+
+    return 1;
+}
+
+
+#if PAYLOAD_VALIDATION_SIMD
+// SSSE3 implementation of the lookup-table UTF-8 validator (Keiser & Lemire,
+// "Validating UTF-8 In Less Than One Instruction Per Byte"). Each 16-byte block
+// is classified with three pshufb nibble lookups against the block shifted by
+// one byte; the bits that survive the AND identify every malformed 2-byte
+// pattern, and the 3rd/4th-byte continuation rule is checked separately.
+// Control characters are caught with plain compares in the same pass.
+// Errors are OR-accumulated and tested once at the end.
+
+#define UTF8_TOO_SHORT      (1 << 0)
+#define UTF8_TOO_LONG       (1 << 1)
+#define UTF8_OVERLONG_3     (1 << 2)
+#define UTF8_TOO_LARGE      (1 << 3)
+#define UTF8_SURROGATE      (1 << 4)
+#define UTF8_OVERLONG_2     (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4     (1 << 6)
+#define UTF8_TWO_CONTS      (1 << 7)
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+__attribute__((target("ssse3")))
+static inline __m128i payload_block_errors(__m128i input, __m128i prev_input)
+{
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+
+    // high nibble of the previous byte
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+
+    // low nibble of the previous byte
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+        UTF8_CARRY | UTF8_OVERLONG_2,
+        UTF8_CARRY,
+        UTF8_CARRY,
+        UTF8_CARRY | UTF8_TOO_LARGE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000);
+
+    // high nibble of the current byte
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+
+    // UTF-8 structure: 2-byte patterns via nibble lookups
+    __m128i b1h = _mm_shuffle_epi8(byte_1_high_table, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble_mask));
+    __m128i b1l = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, nibble_mask));
+    __m128i b2h = _mm_shuffle_epi8(byte_2_high_table, _mm_and_si128(_mm_srli_epi16(input, 4), nibble_mask));
+    __m128i special_cases = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+
+    // two continuations in a row are only legal as the 3rd/4th byte of a sequence
+    __m128i is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 1)));
+    __m128i is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 1)));
+    __m128i must_be_23_cont = _mm_cmpgt_epi8(_mm_or_si128(is_third_byte, is_fourth_byte), _mm_setzero_si128());
+    __m128i cont_errors = _mm_xor_si128(_mm_and_si128(must_be_23_cont, _mm_set1_epi8((char)0x80)), special_cases);
+
+    // C0 controls (<= 0x1F, includes NUL) and DEL
+    __m128i is_c0 = _mm_cmpeq_epi8(_mm_min_epu8(input, _mm_set1_epi8(0x1F)), input);
+    __m128i is_del = _mm_cmpeq_epi8(input, _mm_set1_epi8(0x7F));
+
+    // C1 controls: C2 followed by 80..9F (C2 followed by < 0x80 is already TOO_SHORT)
+    __m128i after_c2 = _mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xC2));
+    __m128i le_9f = _mm_cmpeq_epi8(_mm_min_epu8(input, _mm_set1_epi8((char)0x9F)), input);
+    __m128i is_c1 = _mm_and_si128(after_c2, le_9f);
+
+    return _mm_or_si128(_mm_or_si128(cont_errors, is_c1), _mm_or_si128(is_c0, is_del));
+}
+
+__attribute__((target("ssse3")))
+static inline int payload_is_valid_ssse3(const uint8_t *data, size_t len)
+{
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i errors = _mm_setzero_si128();
+    size_t i = 0;
+
+    // Bytes that would need a continuation in the next block: last byte >= C0,
+    // second-to-last >= E0, third-to-last >= F0.
+    const __m128i max_complete = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                               (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    const __m128i max_control = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i input = _mm_loadu_si128((const __m128i *)(data + i));
+
+        if (_mm_movemask_epi8(input) == 0) {
+            // ASCII block: only controls, or a sequence left open by the previous block, can fail
+            __m128i is_c0 = _mm_cmpeq_epi8(_mm_min_epu8(input, max_control), input);
+            __m128i is_del = _mm_cmpeq_epi8(input, del);
+            __m128i incomplete = _mm_subs_epu8(prev_input, max_complete);
+            errors = _mm_or_si128(errors, _mm_or_si128(_mm_or_si128(is_c0, is_del), incomplete));
+        } else {
+            errors = _mm_or_si128(errors, payload_block_errors(input, prev_input));
+        }
+        prev_input = input;
+    }
+
+    // Pad the tail with spaces: a space after a truncated sequence is TOO_SHORT,
+    // and spaces themselves are never rejected.
+    uint8_t tail[16];
+    memset(tail, ' ', sizeof(tail));
+    memcpy(tail, data + i, len - i);
+    __m128i input = _mm_loadu_si128((const __m128i *)tail);
+    errors = _mm_or_si128(errors, payload_block_errors(input, prev_input));
+
+    // a sequence cut off by the end of the padded block cannot happen (padding is ASCII),
+    // so the only remaining check is whether any error bit was raised
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128())) == 0xFFFF;
+}
+
+// Pick the SSSE3 path only when the running CPU supports it
+static inline int payload_simd_available(void)
+{
+    static int available = -1;
+
+    if (available < 0) {
+        __builtin_cpu_init();
+        available = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    }
+
+    return available;
+}
+#endif
+
+
+// Longest prefix of data[0..len) that does not end inside a multi-byte sequence.
+// Used to truncate already-validated text without emitting a dangling lead byte.
+static inline size_t payload_utf8_prefix_len(const uint8_t *data, size_t len)
+{
+    size_t i = len;
+
+    // step back over up to three continuation bytes to the last lead byte
+    while (i > 0 && len - i < 3 && (data[i - 1] & 0xC0) == 0x80)
+        i--;
+    if (i == 0)
+        return len;
+
+    uint8_t lead = data[i - 1];
+    size_t need = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+    return len - (i - 1) < need ? i - 1 : len;
+}
+
+
+// Entry point used by the server: dispatches to the fastest available implementation.
+static inline int payload_is_valid(const uint8_t *data, size_t len)
+{
+#if PAYLOAD_VALIDATION_SIMD
+    // below one vector the scalar loop is cheaper than padding a block
+    if (len >= 16 && payload_simd_available())
+        return payload_is_valid_ssse3(data, len);
+#endif
+    return payload_is_valid_scalar(data, len);
+}
+
+#endif // PAYLOAD_VALIDATION_H
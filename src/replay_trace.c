@@ -0,0 +1,989 @@
+// replay_trace.c - Deterministic replay of a captured traffic trace against a chat server
+//
+// Replays every connection in a trace recorded with `server_v1_secure -c <trace_file>`
+// over its own loopback socket, preserving the original inter-frame timing
+// (optionally sped up), and reports throughput and reply latency.
+//
+// Build: gcc -O2 -o replay_trace src/replay_trace.c
+// Usage:
+//   replay_trace [options] trace_file                      replay against a running server
+//   replay_trace [options] trace_file baseline candidate   start each server binary in turn,
+//                                                          replay, and print the deltas
+// Options:
+//   -s speed    time scale: 1 = real time (default), 10 = ten times faster, 0 = as fast as possible
+//   -n fanout   replay each traced connection this many times concurrently (default 1)
+//   -H host     server address (default 127.0.0.1), not in compare mode
+//   -p port     server port (default 8080), not in compare mode
+//   -r repeats  replay this many times per server and report median and spread (default 3)
+//
+// When comparing, runs alternate between the two builds and a metric is only
+// called better or worse when the candidate's range of runs does not overlap
+// the baseline's. If the builds did not handle the same traffic (connection
+// failures, drops, lost or unmatched replies, skipped frames differ) no
+// verdict is given at all. The servers are started without arguments, so they
+// listen on their built-in port 8080 on this machine; -H and -p are rejected.
+//
+// Latency is measured from queuing a frame to receiving the MSG_OK/MSG_ERROR it
+// produces. Which frames get a reply is predicted with the server's own rules
+// (SET_NAME always, SEND_MESSAGE only when invalid or before a name is set,
+// unknown types always), so replies can be matched in order per connection.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdint.h>
+
+#include "payload_validation.h"
+#include "trace_format.h"
+
+#define DEFAULT_PORT 8080
+#define DEFAULT_HOST "127.0.0.1"
+#define MAX_NAME_SIZE 31
+#define INBOUND_BUFFER_SIZE 8192
+#define DRAIN_TIMEOUT_US 2000000
+#define SERVER_START_RETRIES 50
+#define DEFAULT_REPEATS 3
+#define MIN_REPEATS_FOR_VERDICT 3
+
+// TLV Protocol Constants
+typedef enum {
+    MSG_SET_NAME = 0x01,
+    MSG_SEND_MESSAGE = 0x02,
+    MSG_ERROR = 0x03,
+    MSG_OK = 0x04
+} message_type_t;
+
+typedef enum {
+    SESSION_UNUSED = 0,
+    SESSION_OPEN,
+    SESSION_CLOSING, // trace closed it, waiting for outstanding replies
+    SESSION_DONE,
+    SESSION_FAILED
+} session_state_t;
+
+typedef struct {
+    int fd;
+    session_state_t state;
+    size_t table_index; // slot in the id -> session table
+    size_t live_index;  // slot in the live list
+    int named; // predicted: server has accepted a name for this connection
+    int welcomed;
+
+    // outbound bytes not yet accepted by the kernel
+    uint8_t *out;
+    size_t out_len, out_off, out_cap;
+
+    // stream offsets where each queued frame ends (FIFO), so a frame only
+    // counts as sent once send() has taken its last byte
+    uint64_t *frame_ends;
+    size_t frames_head, frames_tail, frames_cap;
+    uint64_t queued_bytes, written_bytes;
+    size_t frames_written;
+
+    // partial inbound frame
+    uint8_t in[INBOUND_BUFFER_SIZE];
+    size_t in_len;
+
+    // send timestamps of frames still waiting for a reply (FIFO)
+    uint64_t *pending;
+    size_t pending_head, pending_tail, pending_cap;
+} session_t;
+
+typedef struct {
+    size_t connections;
+    size_t connect_failures;
+    size_t dropped; // closed by the server before the trace closed them
+    size_t frames_sent;    // fully accepted by send()
+    size_t frames_skipped; // never written: connection failed, or closed with the frame still queued
+    uint64_t bytes_sent;   // bytes accepted by send()
+    size_t replies;
+    size_t errors;
+    size_t unmatched_replies;
+    size_t lost_replies;
+    size_t messages_received;
+    double elapsed;
+
+    uint64_t *latencies;
+    size_t latency_count, latency_cap;
+} replay_stats_t;
+
+typedef struct {
+    double speed;
+    size_t fanout;
+    const char *host;
+    int port;
+    size_t repeats;
+} replay_options_t;
+
+// Trace loaded into memory. Record conn_ids are remapped to dense indexes
+// 0..id_count-1 so replay state can be sized by the number of connections
+// rather than by the largest id the capturing server handed out.
+typedef struct {
+    trace_record_t *records;
+    size_t count;
+    size_t id_count;
+    size_t connections; // TRACE_CONNECT records
+} trace_t;
+
+// Sessions of one replay: looked up by dense id, polled from the live list
+typedef struct {
+    session_t **table; // id_count * fanout entries, NULL until connected and after reaping
+    session_t **live;
+    size_t live_count, live_cap;
+    struct pollfd *fds;
+    size_t fds_cap;
+} session_set_t;
+
+
+static void *grow(void *ptr, size_t *cap, size_t elem_size, size_t needed)
+{
+    if (needed <= *cap)
+        return ptr;
+
+    size_t new_cap = *cap ? *cap : 16;
+    while (new_cap < needed)
+        new_cap *= 2;
+
+    void *p = realloc(ptr, new_cap * elem_size);
+    if (p == NULL) {
+        perror("realloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    *cap = new_cap;
+    return p;
+}
+
+
+// Open-addressing map from captured conn_id to dense index, only used while loading
+typedef struct {
+    uint64_t *keys; // conn_id + 1, 0 marks an empty slot
+    size_t *values;
+    size_t cap, count;
+} id_map_t;
+
+static size_t id_map_index(id_map_t *map, uint32_t conn_id)
+{
+    if ((map->count + 1) * 2 > map->cap) {
+        id_map_t bigger = { NULL, NULL, map->cap ? map->cap * 2 : 64, 0 };
+        bigger.keys = calloc(bigger.cap, sizeof(uint64_t));
+        bigger.values = calloc(bigger.cap, sizeof(size_t));
+        if (bigger.keys == NULL || bigger.values == NULL) {
+            perror("calloc failed");
+            exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < map->cap; i++) {
+            if (map->keys[i] == 0)
+                continue;
+            size_t slot = (size_t)(map->keys[i] * 2654435761u) & (bigger.cap - 1);
+            while (bigger.keys[slot] != 0)
+                slot = (slot + 1) & (bigger.cap - 1);
+            bigger.keys[slot] = map->keys[i];
+            bigger.values[slot] = map->values[i];
+        }
+        bigger.count = map->count;
+
+        free(map->keys);
+        free(map->values);
+        *map = bigger;
+    }
+
+    uint64_t key = (uint64_t)conn_id + 1;
+    size_t slot = (size_t)(key * 2654435761u) & (map->cap - 1);
+    while (map->keys[slot] != 0) {
+        if (map->keys[slot] == key)
+            return map->values[slot];
+        slot = (slot + 1) & (map->cap - 1);
+    }
+
+    map->keys[slot] = key;
+    map->values[slot] = map->count;
+    return map->count++;
+}
+
+
+// Load the whole trace into memory so replay timing is not disturbed by file I/O
+static int load_trace(const char *path, trace_t *trace)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror("trace open failed");
+        return -1;
+    }
+
+    if (trace_read_header(fp) != 0) {
+        fprintf(stderr, "%s: not a trace file (or unsupported version)\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    id_map_t ids = {0};
+    size_t cap = 0;
+    uint64_t clock_us = 0;
+    trace_record_t record;
+    int rc;
+
+    memset(trace, 0, sizeof(*trace));
+    while ((rc = trace_read_record(fp, &clock_us, &record)) == 1) {
+        record.conn_id = (uint32_t)id_map_index(&ids, record.conn_id);
+        if (record.kind == TRACE_CONNECT)
+            trace->connections++;
+
+        trace->records = grow(trace->records, &cap, sizeof(trace_record_t), trace->count + 1);
+        trace->records[trace->count++] = record;
+    }
+    fclose(fp);
+
+    trace->id_count = ids.count;
+    free(ids.keys);
+    free(ids.values);
+
+    // The writer's clock starts with the server, not with the first client;
+    // replay from the first event instead of re-enacting the idle lead-in
+    if (trace->count > 0) {
+        uint64_t first_us = trace->records[0].timestamp_us;
+        for (size_t i = 0; i < trace->count; i++)
+            trace->records[i].timestamp_us -= first_us;
+    }
+
+    if (rc < 0)
+        fprintf(stderr, "%s: truncated record after %zu records, replaying what was read\n", path, trace->count);
+
+    return 0;
+}
+
+
+static void free_trace(trace_t *trace)
+{
+    for (size_t i = 0; i < trace->count; i++)
+        free(trace->records[i].payload);
+    free(trace->records);
+}
+
+
+// Mirror of the server's reply rules in handle_client_message()
+static int expects_reply(session_t *session, uint8_t type, const uint8_t *payload, uint32_t length)
+{
+    if (type != MSG_SET_NAME && type != MSG_SEND_MESSAGE)
+        return 1; // unknown type -> MSG_ERROR
+
+    if (!payload_is_valid(payload, length))
+        return 1; // invalid encoding -> MSG_ERROR
+
+    if (type == MSG_SET_NAME) {
+        if (length > 0 && length < MAX_NAME_SIZE)
+            session->named = 1;
+        return 1; // MSG_OK or MSG_ERROR
+    }
+
+    return !session->named; // "Set name first"
+}
+
+
+static void session_close(session_t *session, session_state_t state, replay_stats_t *stats)
+{
+    if (session->fd >= 0) {
+        close(session->fd);
+        session->fd = -1;
+    }
+
+    stats->lost_replies += session->pending_tail - session->pending_head;
+    session->pending_head = session->pending_tail = 0;
+    stats->frames_skipped += session->frames_tail - session->frames_head;
+    session->frames_head = session->frames_tail = 0;
+
+    // the kernel took these bytes, but a server that never greeted us (e.g. full) didn't serve them
+    if (!session->welcomed) {
+        stats->frames_sent -= session->frames_written;
+        stats->frames_skipped += session->frames_written;
+        stats->bytes_sent -= session->written_bytes;
+        session->frames_written = 0;
+        session->written_bytes = 0;
+    }
+    session->state = state;
+}
+
+
+// Allocate a session for table slot `index`, start its connect, and put it on the live list
+static void session_open(session_set_t *set, size_t index, struct sockaddr_in *server, replay_stats_t *stats)
+{
+    session_t *session = calloc(1, sizeof(session_t));
+    if (session == NULL) {
+        perror("calloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    session->table_index = index;
+    session->live_index = set->live_count;
+    set->table[index] = session;
+    set->live = grow(set->live, &set->live_cap, sizeof(session_t *), set->live_count + 1);
+    set->live[set->live_count++] = session;
+    stats->connections++;
+
+    session->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (session->fd < 0) {
+        stats->connect_failures++;
+        session->state = SESSION_FAILED;
+        return;
+    }
+
+    fcntl(session->fd, F_SETFL, fcntl(session->fd, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(session->fd, (struct sockaddr *)server, sizeof(*server)) < 0 && errno != EINPROGRESS) {
+        stats->connect_failures++;
+        session_close(session, SESSION_FAILED, stats);
+        return;
+    }
+
+    session->state = SESSION_OPEN;
+}
+
+
+static void session_queue_frame(session_t *session, const trace_record_t *record, uint64_t now, replay_stats_t *stats)
+{
+    if (session == NULL || session->state != SESSION_OPEN) {
+        stats->frames_skipped++;
+        return;
+    }
+
+    size_t frame_len = 5 + (size_t)record->length;
+    session->out = grow(session->out, &session->out_cap, 1, session->out_len + frame_len);
+
+    uint8_t *header = session->out + session->out_len;
+    header[0] = record->type;
+    header[1] = (record->length >> 24) & 0xFF; // network byte order
+    header[2] = (record->length >> 16) & 0xFF;
+    header[3] = (record->length >> 8) & 0xFF;
+    header[4] = record->length & 0xFF;
+    if (record->length > 0)
+        memcpy(header + 5, record->payload, record->length);
+    session->out_len += frame_len;
+
+    session->queued_bytes += frame_len;
+    session->frame_ends = grow(session->frame_ends, &session->frames_cap, sizeof(uint64_t), session->frames_tail + 1);
+    session->frame_ends[session->frames_tail++] = session->queued_bytes;
+
+    if (expects_reply(session, record->type, record->payload, record->length)) {
+        session->pending = grow(session->pending, &session->pending_cap, sizeof(uint64_t), session->pending_tail + 1);
+        session->pending[session->pending_tail++] = now;
+    }
+}
+
+
+static void session_flush(session_t *session, replay_stats_t *stats)
+{
+    while (session->out_off < session->out_len) {
+        ssize_t n = send(session->fd, session->out + session->out_off, session->out_len - session->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            if (session->state == SESSION_OPEN && !session->welcomed)
+                stats->connect_failures++;
+            else
+                stats->dropped++;
+            session_close(session, SESSION_FAILED, stats);
+            return;
+        }
+        session->out_off += (size_t)n;
+        session->written_bytes += (uint64_t)n;
+        stats->bytes_sent += (uint64_t)n;
+
+        while (session->frames_head < session->frames_tail && session->frame_ends[session->frames_head] <= session->written_bytes) {
+            session->frames_head++;
+            session->frames_written++;
+            stats->frames_sent++;
+        }
+    }
+
+    session->frames_head = session->frames_tail = 0;
+
+    session->out_len = session->out_off = 0;
+    if (session->state == SESSION_CLOSING)
+        shutdown(session->fd, SHUT_WR);
+}
+
+
+static void record_latency(replay_stats_t *stats, uint64_t latency_us)
+{
+    stats->latencies = grow(stats->latencies, &stats->latency_cap, sizeof(uint64_t), stats->latency_count + 1);
+    stats->latencies[stats->latency_count++] = latency_us;
+}
+
+
+// Streaming TLV parse of whatever the server sent
+static void session_read(session_t *session, uint64_t now, replay_stats_t *stats)
+{
+    ssize_t n = recv(session->fd, session->in + session->in_len, sizeof(session->in) - session->in_len, 0);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+
+    if (n <= 0) {
+        if (!session->welcomed) {
+            // refused (e.g. server full) before it ever greeted us
+            stats->connect_failures++;
+            session_close(session, SESSION_FAILED, stats);
+        } else if (session->state == SESSION_CLOSING) {
+            session_close(session, SESSION_DONE, stats);
+        } else {
+            stats->dropped++;
+            session_close(session, SESSION_FAILED, stats);
+        }
+        return;
+    }
+
+    session->in_len += (size_t)n;
+
+    size_t off = 0;
+    while (session->in_len - off >= 5) {
+        const uint8_t *frame = session->in + off;
+        uint32_t length = ((uint32_t)frame[1] << 24) | ((uint32_t)frame[2] << 16) | ((uint32_t)frame[3] << 8) | frame[4];
+
+        if (length > sizeof(session->in) - 5) {
+            fprintf(stderr, "Oversized frame (%u bytes) from server, dropping connection\n", length);
+            stats->dropped++;
+            session_close(session, SESSION_FAILED, stats);
+            return;
+        }
+        if (session->in_len - off < 5 + length)
+            break;
+
+        if (frame[0] == MSG_OK || frame[0] == MSG_ERROR) {
+            stats->replies++;
+            if (frame[0] == MSG_ERROR)
+                stats->errors++;
+
+            if (session->pending_head < session->pending_tail)
+                record_latency(stats, now - session->pending[session->pending_head++]);
+            else
+                stats->unmatched_replies++;
+        } else if (!session->welcomed) {
+            session->welcomed = 1;
+        } else {
+            stats->messages_received++;
+        }
+
+        off += 5 + length;
+    }
+
+    memmove(session->in, session->in + off, session->in_len - off);
+    session->in_len -= off;
+}
+
+
+static int session_busy(const session_t *session)
+{
+    if (session->state == SESSION_CLOSING)
+        return 1;
+    return session->state == SESSION_OPEN && (session->pending_head < session->pending_tail || session->out_off < session->out_len);
+}
+
+
+static int resolve_server(const replay_options_t *options, struct sockaddr_in *server)
+{
+    memset(server, 0, sizeof(*server));
+    server->sin_family = AF_INET;
+    server->sin_port = htons(options->port);
+    return inet_pton(AF_INET, options->host, &server->sin_addr) == 1 ? 0 : -1;
+}
+
+
+// Free every session that has finished, keeping the live list dense
+static void reap_sessions(session_set_t *set, replay_stats_t *stats, int all)
+{
+    size_t i = 0;
+
+    while (i < set->live_count) {
+        session_t *session = set->live[i];
+
+        if (all && session->fd >= 0)
+            session_close(session, SESSION_DONE, stats);
+        if (session->state != SESSION_DONE && session->state != SESSION_FAILED) {
+            i++;
+            continue;
+        }
+
+        set->table[session->table_index] = NULL;
+        set->live[i] = set->live[--set->live_count];
+        set->live[i]->live_index = i;
+        free(session->out);
+        free(session->frame_ends);
+        free(session->pending);
+        free(session);
+    }
+}
+
+
+// Drive one full replay of the trace. Returns 0 on success.
+static int replay(const trace_t *trace, const replay_options_t *options, replay_stats_t *stats)
+{
+    struct sockaddr_in server;
+    session_set_t set = {0};
+
+    memset(stats, 0, sizeof(*stats));
+    if (resolve_server(options, &server) != 0) {
+        fprintf(stderr, "Invalid server address %s\n", options->host);
+        return -1;
+    }
+
+    // one pointer per (copy, connection); sessions themselves exist only while connected
+    set.table = calloc(trace->id_count * options->fanout + 1, sizeof(session_t *));
+    if (set.table == NULL) {
+        perror("calloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    const trace_record_t *records = trace->records;
+    size_t count = trace->count;
+    uint64_t start = trace_now_us();
+    uint64_t now = start;
+    uint64_t drain_deadline = 0;
+    size_t next = 0;
+
+    while (1) {
+        now = trace_now_us();
+
+        // dispatch every trace event that is due
+        while (next < count) {
+            const trace_record_t *record = &records[next];
+            uint64_t due = options->speed > 0 ? start + (uint64_t)(record->timestamp_us / options->speed) : now;
+            if (due > now)
+                break;
+
+            for (size_t copy = 0; copy < options->fanout; copy++) {
+                size_t index = copy * trace->id_count + record->conn_id;
+                session_t *session = set.table[index];
+
+                if (record->kind == TRACE_CONNECT && session == NULL) {
+                    session_open(&set, index, &server, stats);
+                } else if (record->kind == TRACE_FRAME) {
+                    session_queue_frame(session, record, now, stats);
+                } else if (record->kind == TRACE_CLOSE && session != NULL && session->state == SESSION_OPEN) {
+                    session->state = SESSION_CLOSING;
+                    if (session->out_off == session->out_len)
+                        shutdown(session->fd, SHUT_WR);
+                }
+            }
+            next++;
+        }
+
+        reap_sessions(&set, stats, 0);
+
+        if (next == count && drain_deadline == 0)
+            drain_deadline = now + DRAIN_TIMEOUT_US;
+
+        // poll only live sessions
+        int busy = 0;
+        set.fds = grow(set.fds, &set.fds_cap, sizeof(struct pollfd), set.live_count + 1);
+        for (size_t i = 0; i < set.live_count; i++) {
+            session_t *session = set.live[i];
+
+            set.fds[i].fd = session->fd;
+            set.fds[i].events = POLLIN | (session->out_off < session->out_len ? POLLOUT : 0);
+            set.fds[i].revents = 0;
+            busy |= session_busy(session);
+        }
+
+        if (next == count && (!busy || now >= drain_deadline))
+            break;
+
+        int timeout_ms = 10;
+        if (next < count && options->speed > 0) {
+            uint64_t due = start + (uint64_t)(records[next].timestamp_us / options->speed);
+            uint64_t wait_ms = due > now ? (due - now + 999) / 1000 : 0;
+            if (wait_ms < (uint64_t)timeout_ms)
+                timeout_ms = (int)wait_ms;
+        } else if (next < count) {
+            timeout_ms = 0;
+        }
+
+        if (poll(set.fds, set.live_count, timeout_ms) < 0 && errno != EINTR) {
+            perror("poll failed");
+            break;
+        }
+
+        now = trace_now_us();
+        for (size_t i = 0; i < set.live_count; i++) {
+            session_t *session = set.live[i];
+
+            if (session->fd >= 0 && (set.fds[i].revents & POLLOUT))
+                session_flush(session, stats);
+            if (session->fd >= 0 && (set.fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                session_read(session, now, stats);
+        }
+    }
+
+    stats->elapsed = (trace_now_us() - start) / 1e6;
+
+    reap_sessions(&set, stats, 1);
+    free(set.table);
+    free(set.live);
+    free(set.fds);
+    return 0;
+}
+
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+// Latency percentile in microseconds (latencies must be sorted)
+static double percentile(const replay_stats_t *stats, double p)
+{
+    if (stats->latency_count == 0)
+        return 0;
+
+    size_t idx = (size_t)(p / 100.0 * (stats->latency_count - 1) + 0.5);
+    return (double)stats->latencies[idx];
+}
+
+
+typedef struct {
+    const char *name;
+    double value;
+    int lower_is_better;
+} metric_t;
+
+#define METRIC_COUNT 7
+
+static void collect_metrics(replay_stats_t *stats, metric_t metrics[METRIC_COUNT])
+{
+    qsort(stats->latencies, stats->latency_count, sizeof(uint64_t), compare_u64);
+
+    double elapsed = stats->elapsed > 0 ? stats->elapsed : 1e-9;
+    metrics[0] = (metric_t){ "frames/s", stats->frames_sent / elapsed, 0 };
+    metrics[1] = (metric_t){ "MB/s", stats->bytes_sent / elapsed / 1e6, 0 };
+    metrics[2] = (metric_t){ "elapsed s", stats->elapsed, 1 };
+    metrics[3] = (metric_t){ "latency p50 us", percentile(stats, 50), 1 };
+    metrics[4] = (metric_t){ "latency p90 us", percentile(stats, 90), 1 };
+    metrics[5] = (metric_t){ "latency p99 us", percentile(stats, 99), 1 };
+    metrics[6] = (metric_t){ "latency max us", percentile(stats, 100), 1 };
+}
+
+
+typedef struct {
+    const char *name;
+    double median, min, max;
+    int lower_is_better;
+} metric_summary_t;
+
+// Counters that must match between builds for a comparison to mean anything
+typedef struct {
+    const char *name;
+    size_t total;
+} health_counter_t;
+
+#define HEALTH_COUNT 5
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+// Median, min and max of each metric across runs
+static void summarize(replay_stats_t *runs, size_t repeats, metric_summary_t summary[METRIC_COUNT])
+{
+    metric_t (*metrics)[METRIC_COUNT] = calloc(repeats, sizeof(*metrics));
+    double *values = calloc(repeats, sizeof(double));
+    if (metrics == NULL || values == NULL) {
+        perror("calloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t r = 0; r < repeats; r++)
+        collect_metrics(&runs[r], metrics[r]);
+
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        for (size_t r = 0; r < repeats; r++)
+            values[r] = metrics[r][m].value;
+        qsort(values, repeats, sizeof(double), compare_double);
+
+        summary[m].name = metrics[0][m].name;
+        summary[m].lower_is_better = metrics[0][m].lower_is_better;
+        summary[m].min = values[0];
+        summary[m].max = values[repeats - 1];
+        summary[m].median = repeats % 2 ? values[repeats / 2] : (values[repeats / 2 - 1] + values[repeats / 2]) / 2;
+    }
+
+    free(values);
+    free(metrics);
+}
+
+
+static void collect_health(const replay_stats_t *runs, size_t repeats, health_counter_t health[HEALTH_COUNT])
+{
+    health[0] = (health_counter_t){ "connection failures", 0 };
+    health[1] = (health_counter_t){ "dropped by server", 0 };
+    health[2] = (health_counter_t){ "lost replies", 0 };
+    health[3] = (health_counter_t){ "unmatched replies", 0 };
+    health[4] = (health_counter_t){ "skipped frames", 0 };
+
+    for (size_t r = 0; r < repeats; r++) {
+        health[0].total += runs[r].connect_failures;
+        health[1].total += runs[r].dropped;
+        health[2].total += runs[r].lost_replies;
+        health[3].total += runs[r].unmatched_replies;
+        health[4].total += runs[r].frames_skipped;
+    }
+}
+
+
+// (max - min) relative to the median, in percent
+static double spread_percent(const metric_summary_t *summary)
+{
+    return summary->median != 0 ? (summary->max - summary->min) / summary->median * 100.0 : 0;
+}
+
+
+static void print_stats(const char *label, replay_stats_t *runs, size_t repeats)
+{
+    metric_summary_t summary[METRIC_COUNT];
+    size_t connections = 0, failures = 0, dropped = 0, frames = 0, skipped = 0;
+    size_t replies = 0, errors = 0, unmatched = 0, lost = 0, messages = 0;
+    uint64_t bytes = 0;
+
+    for (size_t r = 0; r < repeats; r++) {
+        connections += runs[r].connections;
+        failures += runs[r].connect_failures;
+        dropped += runs[r].dropped;
+        frames += runs[r].frames_sent;
+        bytes += runs[r].bytes_sent;
+        skipped += runs[r].frames_skipped;
+        replies += runs[r].replies;
+        errors += runs[r].errors;
+        unmatched += runs[r].unmatched_replies;
+        lost += runs[r].lost_replies;
+        messages += runs[r].messages_received;
+    }
+    summarize(runs, repeats, summary);
+
+    printf("== %s (%zu runs, counters are totals) ==\n", label, repeats);
+    printf("  connections      %zu (failed %zu, dropped by server %zu)\n", connections, failures, dropped);
+    printf("  frames sent      %zu (%llu bytes, skipped %zu)\n", frames, (unsigned long long)bytes, skipped);
+    printf("  replies          %zu (errors %zu, unmatched %zu, lost %zu)\n", replies, errors, unmatched, lost);
+    printf("  messages recv'd  %zu\n", messages);
+    printf("  %-16s %14s %14s %14s %8s\n", "metric", "median", "min", "max", "spread");
+    for (int m = 0; m < METRIC_COUNT; m++)
+        printf("  %-16s %14.2f %14.2f %14.2f %7.1f%%\n", summary[m].name, summary[m].median,
+               summary[m].min, summary[m].max, spread_percent(&summary[m]));
+}
+
+
+static void print_comparison(replay_stats_t *baseline, replay_stats_t *candidate, size_t repeats)
+{
+    metric_summary_t base[METRIC_COUNT], cand[METRIC_COUNT];
+    health_counter_t base_health[HEALTH_COUNT], cand_health[HEALTH_COUNT];
+    int comparable = 1;
+
+    summarize(baseline, repeats, base);
+    summarize(candidate, repeats, cand);
+    collect_health(baseline, repeats, base_health);
+    collect_health(candidate, repeats, cand_health);
+
+    printf("== comparison ==\n");
+    for (int h = 0; h < HEALTH_COUNT; h++) {
+        if (base_health[h].total != cand_health[h].total) {
+            printf("  !!! WARNING: %s differ: baseline %zu, candidate %zu\n", base_health[h].name,
+                   base_health[h].total, cand_health[h].total);
+            comparable = 0;
+        }
+    }
+    if (!comparable)
+        printf("  !!! The builds did not handle the same traffic; the deltas below are NOT a verdict.\n");
+
+    printf("  %-16s %14s %8s %14s %8s %10s\n", "metric", "baseline", "spread", "candidate", "spread", "delta");
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        double delta = base[m].median != 0 ? (cand[m].median - base[m].median) / base[m].median * 100.0 : 0;
+        const char *verdict = "";
+
+        if (comparable && repeats >= MIN_REPEATS_FOR_VERDICT) {
+            // only call it when every candidate run is beyond every baseline run
+            if (cand[m].min > base[m].max)
+                verdict = base[m].lower_is_better ? "worse" : "better";
+            else if (cand[m].max < base[m].min)
+                verdict = base[m].lower_is_better ? "better" : "worse";
+            else
+                verdict = "~ noise";
+        }
+
+        printf("  %-16s %14.2f %7.1f%% %14.2f %7.1f%% %+9.1f%% %s\n", base[m].name, base[m].median,
+               spread_percent(&base[m]), cand[m].median, spread_percent(&cand[m]), delta, verdict);
+    }
+
+    if (comparable && repeats < MIN_REPEATS_FOR_VERDICT)
+        printf("  (no verdicts: use -r %d or more to separate changes from run-to-run noise)\n", MIN_REPEATS_FOR_VERDICT);
+}
+
+
+// Connect and disconnect once; used to detect when a spawned server is accepting
+static int probe_server(const replay_options_t *options)
+{
+    struct sockaddr_in server;
+    int fd, rc;
+
+    if (resolve_server(options, &server) != 0)
+        return -1;
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        return -1;
+
+    rc = connect(fd, (struct sockaddr *)&server, sizeof(server));
+    close(fd);
+    return rc;
+}
+
+
+// fork/exec a server binary with its console output discarded
+static pid_t start_server(const char *path, const replay_options_t *options)
+{
+    if (probe_server(options) == 0) {
+        fprintf(stderr, "Port %d is already in use, stop the running server first\n", options->port);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        return -1;
+    }
+
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+            close(devnull);
+        }
+        execl(path, path, (char *)NULL);
+        _exit(127);
+    }
+
+    for (int attempt = 0; attempt < SERVER_START_RETRIES; attempt++) {
+        usleep(100000);
+        if (probe_server(options) == 0)
+            return pid;
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+            break;
+    }
+
+    fprintf(stderr, "%s did not start listening on port %d\n", path, options->port);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+
+static void stop_server(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+
+static int replay_with_server(const char *server_path, const trace_t *trace,
+                              const replay_options_t *options, replay_stats_t *stats)
+{
+    pid_t pid = start_server(server_path, options);
+    if (pid < 0)
+        return -1;
+
+    int rc = replay(trace, options, stats);
+    stop_server(pid);
+    return rc;
+}
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-s speed] [-n fanout] [-r repeats] [-H host] [-p port] trace_file\n", prog);
+    fprintf(stderr, "       %s [-s speed] [-n fanout] [-r repeats] trace_file baseline_server candidate_server\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char *argv[])
+{
+    replay_options_t options = { 1.0, 1, DEFAULT_HOST, DEFAULT_PORT, DEFAULT_REPEATS };
+    int address_given = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:r:H:p:")) != -1) {
+        switch (opt) {
+            case 's': options.speed = atof(optarg); break;
+            case 'n': options.fanout = strtoul(optarg, NULL, 10); break;
+            case 'r': options.repeats = strtoul(optarg, NULL, 10); break;
+            case 'H': options.host = optarg; address_given = 1; break;
+            case 'p': options.port = atoi(optarg); address_given = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    int positional = argc - optind;
+    if ((positional != 1 && positional != 3) || options.speed < 0 || options.fanout == 0 || options.repeats == 0)
+        usage(argv[0]);
+
+    // the spawned servers always listen on their own hard-coded port
+    if (positional == 3 && address_given) {
+        fprintf(stderr, "-H and -p cannot be used when comparing: the servers are started on 127.0.0.1:%d\n", DEFAULT_PORT);
+        usage(argv[0]);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    trace_t trace;
+    if (load_trace(argv[optind], &trace) != 0)
+        return EXIT_FAILURE;
+
+    if (options.speed > 0)
+        printf("Loaded %zu records, %zu connections, fanout %zu, speed %gx\n", trace.count, trace.connections, options.fanout, options.speed);
+    else
+        printf("Loaded %zu records, %zu connections, fanout %zu, speed max\n", trace.count, trace.connections, options.fanout);
+
+    replay_stats_t *baseline = calloc(options.repeats, sizeof(replay_stats_t));
+    replay_stats_t *candidate = calloc(options.repeats, sizeof(replay_stats_t));
+    if (baseline == NULL || candidate == NULL) {
+        perror("calloc failed");
+        return EXIT_FAILURE;
+    }
+
+    int rc = 0;
+    if (positional == 1) {
+        for (size_t r = 0; r < options.repeats && rc == 0; r++)
+            rc = replay(&trace, &options, &baseline[r]);
+        if (rc == 0)
+            print_stats("replay", baseline, options.repeats);
+    } else {
+        // alternate builds so slow drift on the machine hits both equally
+        for (size_t r = 0; r < options.repeats && rc == 0; r++) {
+            rc = replay_with_server(argv[optind + 1], &trace, &options, &baseline[r]);
+            if (rc == 0)
+                rc = replay_with_server(argv[optind + 2], &trace, &options, &candidate[r]);
+        }
+        if (rc == 0) {
+            print_stats(argv[optind + 1], baseline, options.repeats);
+            print_stats(argv[optind + 2], candidate, options.repeats);
+            print_comparison(baseline, candidate, options.repeats);
+        }
+    }
+
+    for (size_t r = 0; r < options.repeats; r++) {
+        free(baseline[r].latencies);
+        free(candidate[r].latencies);
+    }
+    free(baseline);
+    free(candidate);
+    free_trace(&trace);
+    return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -8,9 +8,16 @@
 #include <arpa/inet.h>
 #include <stdint.h>
 #include <errno.h>
+#include <signal.h>
+
+#include "payload_validation.h"
+#include "trace_format.h"
 
 #define PORT 8080
+// override at build time (-DMAX_CLIENTS=n) for load testing; select() caps this at FD_SETSIZE
+#ifndef MAX_CLIENTS
 #define MAX_CLIENTS 10
+#endif
 #define MAX_MESSAGE_SIZE 4096
 #define MAX_NAME_SIZE 31
 #define BUFFER_SIZE 1024
@@ -48,17 +55,27 @@ typedef struct {
     // Buffer for assembling partial messages
     uint8_t buffer[MAX_MESSAGE_SIZE];
     size_t buffer_len;
+    // connection id used in the capture trace
+    uint32_t trace_id;
 } client_info_t;
 
 client_info_t clients[MAX_CLIENTS] = {0};
 
+// Traffic capture (enabled with -c <trace_file>)
+trace_writer_t capture = {0};
+uint32_t next_trace_id = 1;
+
+// cleared by SIGINT/SIGTERM so the capture trace is flushed on shutdown
+volatile sig_atomic_t server_running = 1;
+
 // function prototypes
 int set_up_server_socket();
 int send_message(int socket, message_type_t type, const char *data, uint32_t data_len);
-void broadcast_message(int sender_socket, const char *username, const char *message);
+void broadcast_message(int sender_socket, const char *username, const char *message, uint32_t message_len);
 int find_client_index(int socket_fd);
 void handle_client_message(int client_socket, message_type_t type, const char *data, uint32_t data_len);
 int process_client_data(client_info_t * client);
+void handle_shutdown_signal(int signum);
 
 
 // Function to initialize the server socket
@@ -94,8 +111,9 @@ int set_up_server_socket()
     }
 
     // start listening for incoming connections
-    // The second argument (3) is the "backlog" - the queue for pending connections
-    if (listen(server_fd, 3) < 0) {
+    // The second argument is the "backlog" - the queue for pending connections.
+    // Keep it at the system maximum so bursts of connects are not dropped and retried after 1s.
+    if (listen(server_fd, SOMAXCONN) < 0) {
         perror("listen failed");
         close(server_fd);
         exit(EXIT_FAILURE);
@@ -153,11 +171,10 @@ int process_client_data(client_info_t *client)
         // check for complete message
         if (client->buffer_len >= 5 + length) {
             // process complete message
+            // payload is length-delimited, not NUL-terminated
             char *message_data = (char *)(client->buffer + 5);
-            if (length > 0) {
-                message_data[length] = '\0';
-            }
 
+            trace_write(&capture, TRACE_FRAME, client->trace_id, type, client->buffer + 5, length);
             handle_client_message(client->socket_fd, type, message_data, length);
 
             // Remove processed message from buffer
@@ -182,22 +199,29 @@ void handle_client_message(int client_socket, message_type_t type, const char *d
         return;
     }
 
-    // Only print data if it's a reasonable before accesing data
-    if (data != NULL && data_len > 0 && data_len <= 100) {
-        printf("DEBUG: data='%.*s'\n", data_len, data);
-    }
-
-
     int client_index = find_client_index(client_socket);
     if (client_index == -1) {
         printf("Error: Message from unknown client socket %d\n", client_socket);
         return;
     }
 
+    // Validate text payloads once, on the TLV length: well-formed UTF-8, no control characters, no embedded NULs
+    if ((type == MSG_SET_NAME || type == MSG_SEND_MESSAGE) && !payload_is_valid((const uint8_t *)data, data_len)) {
+        printf("Rejected malformed payload (type %d) from client %d\n", type, client_socket);
+        send_message(client_socket, MSG_ERROR, "Invalid payload encoding", 24);
+        return;
+    }
+
+    // Only print data if it's a reasonable size, and only once it is known to be
+    // printable, so control bytes in a rejected frame never reach the console
+    if (data != NULL && data_len > 0 && data_len <= 100 && payload_is_valid((const uint8_t *)data, data_len)) {
+        printf("DEBUG: data='%.*s'\n", data_len, data);
+    }
+
     switch (type) {
         case MSG_SET_NAME:
-            if (data_len > 0 && data_len <= MAX_NAME_SIZE) {
-                strncpy(clients[client_index].name, data, data_len);
+            if (data_len > 0 && data_len < MAX_NAME_SIZE) {
+                memcpy(clients[client_index].name, data, data_len);
                 clients[client_index].name[data_len] = '\0';
                 printf("Client %d set name to: %s\n", client_socket, clients[client_index].name);
                 send_message(client_socket, MSG_OK, "Name set", 8);
@@ -210,8 +234,8 @@ void handle_client_message(int client_socket, message_type_t type, const char *d
             if (strlen(clients[client_index].name) == 0) {
                 send_message(client_socket, MSG_ERROR, "Set name first", 14);
             } else if (data_len > 0) {
-                printf("Broadcasting message from %s: %s\n", clients[client_index].name, data);
-                broadcast_message(client_socket, clients[client_index].name, data);
+                printf("Broadcasting message from %s: %.*s\n", clients[client_index].name, (int)data_len, data);
+                broadcast_message(client_socket, clients[client_index].name, data, data_len);
             }
             break;
 
@@ -224,18 +248,23 @@ void handle_client_message(int client_socket, message_type_t type, const char *d
 
 
 // Function to broadcast a message to all connected clients except the sender
-void broadcast_message(int sender_socket, const char *username, const char *message) {
+void broadcast_message(int sender_socket, const char *username, const char *message, uint32_t message_len) {
     char formatted_message[BUFFER_SIZE];
 
     // Format the message as "[username] message"
-    snprintf(formatted_message, BUFFER_SIZE, "[%s] %s", username, message);
+    int formatted_len = snprintf(formatted_message, BUFFER_SIZE, "[%s] %.*s", username, (int)message_len, message);
+    if (formatted_len >= BUFFER_SIZE) {
+        // truncated: cut back to a code point boundary so clients still get valid UTF-8
+        formatted_len = (int)payload_utf8_prefix_len((const uint8_t *)formatted_message, BUFFER_SIZE - 1);
+    }
 
     for (int i = 0; i < MAX_CLIENTS; i++) {
         int dest_socket = clients[i].socket_fd;
 
         // check if the socket is valid and it's not the sender
         if (dest_socket > 0 && dest_socket != sender_socket) {
-            send(dest_socket, formatted_message, strlen(formatted_message), 0);
+            // framed like every other server message so clients can parse their inbound stream
+            send_message(dest_socket, MSG_SEND_MESSAGE, formatted_message, formatted_len);
         }
     }
 
@@ -256,12 +285,41 @@ int find_client_index(int socket_fd) {
 }
 
 
-int main(void)
+void handle_shutdown_signal(int signum)
+{
+    (void)signum;
+    server_running = 0;
+}
+
+
+int main(int argc, char *argv[])
 {
     int server_fd, new_socket, max_fd, activity, i, sd;
     struct sockaddr_in address;
     int addrlen = sizeof(address);
     fd_set readfds;
+    struct sigaction sa;
+
+    // optional traffic capture: server_v1_secure -c <trace_file>
+    if (argc == 3 && strcmp(argv[1], "-c") == 0) {
+        if (trace_writer_open(&capture, argv[2]) != 0) {
+            perror("capture file open failed");
+            exit(EXIT_FAILURE);
+        }
+        printf("Capturing inbound traffic to %s\n", argv[2]);
+    } else if (argc != 1) {
+        fprintf(stderr, "Usage: %s [-c trace_file]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // no SA_RESTART: select() must return EINTR so the loop can exit cleanly
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_shutdown_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // a client closing mid-send must not kill the server
+    signal(SIGPIPE, SIG_IGN);
 
     // Setup the server socket
     server_fd = set_up_server_socket();
@@ -269,7 +327,7 @@ int main(void)
     //printf("Waiting for connections...\n");
 
     // Main server loop
-    while(1) {
+    while(server_running) {
         // clear the socket set
         FD_ZERO(&readfds);
 
@@ -291,8 +349,10 @@ int main(void)
         // Wait for activity on any socket
         activity = select(max_fd + 1, &readfds, NULL, NULL, NULL);
 
-        if ((activity < 0) && (errno != EINTR)) {
-            perror("select error");
+        if (activity < 0) {
+            if (errno != EINTR)
+                perror("select error");
+            continue;
         }
 
         // if something happened on the server socket, its an incoming connection
@@ -311,14 +371,23 @@ int main(void)
                     clients[i].socket_fd = new_socket;
                     clients[i].name[0] = '\0';
                     clients[i].buffer_len = 0;
+                    clients[i].trace_id = next_trace_id++;
 
                     printf("Adding to list of sockets as index %d\n", i);
+                    trace_write(&capture, TRACE_CONNECT, clients[i].trace_id, 0, NULL, 0);
 
                     // Send welcome message with instruction
-                    send_message(new_socket, MSG_SEND_MESSAGE, "Welcome! Send a SET_NAME message to begin.", 45);
+                    const char welcome[] = "Welcome! Send a SET_NAME message to begin.";
+                    send_message(new_socket, MSG_SEND_MESSAGE, welcome, sizeof(welcome) - 1);
                     break;
                 }
             }
+
+            // server full: refuse instead of leaking the socket
+            if (i == MAX_CLIENTS) {
+                printf("Server full, rejecting socket fd %d\n", new_socket);
+                close(new_socket);
+            }
         }
 
         // Check each client socket for IO operations
@@ -332,6 +401,8 @@ int main(void)
                     getpeername(sd, (struct sockaddr*)&address, (socklen_t*)&addrlen);
                     printf("Host disconnected, IP: %s, PORT: %d, NAME: %s\n", inet_ntoa(address.sin_addr), ntohs(address.sin_port), clients[i].name[0] ? clients[i].name : "<unamed>");
 
+                    trace_write(&capture, TRACE_CLOSE, clients[i].trace_id, 0, NULL, 0);
+
                     // close the socket and mark as 0 in list for reuse
                     close(sd);
                     clients[i].socket_fd = 0;
@@ -342,5 +413,8 @@ int main(void)
         }
     }
 
+    printf("Shutting down\n");
+    trace_writer_close(&capture);
+    close(server_fd);
     return 0;
 }
@@ -0,0 +1,188 @@
+// trace_format.h - Binary traffic trace written by the server's capture mode and read by replay_trace
+//
+// File layout:
+//   magic "SCPTRACE" (8 bytes) | version (1 byte)
+//   followed by records until EOF:
+//     kind (1 byte) | delta_us (varint) | conn_id (varint)
+//     TRACE_FRAME only: type (1 byte) | length (varint) | payload (length bytes)
+//
+// delta_us is the time since the previous record, so timestamps stay small.
+// Varints are unsigned LEB128 (7 bits per byte, low bits first).
+//
+// The server's capture writer and replay_trace's reader both come from this
+// file, so a format change cannot update one side and not the other.
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#define TRACE_MAGIC "SCPTRACE"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_VERSION 1
+#define TRACE_MAX_PAYLOAD (1024 * 1024)
+
+typedef enum {
+    TRACE_CONNECT = 0x01, // a client connected
+    TRACE_FRAME = 0x02,   // a complete inbound TLV frame
+    TRACE_CLOSE = 0x03    // the client disconnected
+} trace_kind_t;
+
+typedef struct {
+    uint8_t kind;
+    uint64_t timestamp_us; // absolute, microseconds since capture start
+    uint32_t conn_id;
+    uint8_t type;          // TRACE_FRAME only
+    uint32_t length;       // TRACE_FRAME only
+    uint8_t *payload;      // TRACE_FRAME only, owned by the record
+} trace_record_t;
+
+typedef struct {
+    FILE *fp;
+    uint64_t start_us;
+    uint64_t last_us;
+} trace_writer_t;
+
+
+static inline uint64_t trace_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+
+static inline void trace_put_varint(FILE *fp, uint64_t value)
+{
+    while (value >= 0x80) {
+        fputc((int)((value & 0x7F) | 0x80), fp);
+        value >>= 7;
+    }
+    fputc((int)value, fp);
+}
+
+
+// Returns 0 on success, -1 on EOF or a varint longer than 64 bits
+static inline int trace_get_varint(FILE *fp, uint64_t *value)
+{
+    uint64_t result = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(fp);
+        if (c == EOF)
+            return -1;
+        result |= (uint64_t)(c & 0x7F) << shift;
+        if ((c & 0x80) == 0) {
+            *value = result;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+// Create the trace file and write its header. Returns 0 on success, -1 on error.
+static inline int trace_writer_open(trace_writer_t *writer, const char *path)
+{
+    writer->fp = fopen(path, "wb");
+    if (writer->fp == NULL)
+        return -1;
+
+    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, writer->fp);
+    fputc(TRACE_VERSION, writer->fp);
+
+    writer->start_us = trace_now_us();
+    writer->last_us = writer->start_us;
+    return 0;
+}
+
+
+static inline void trace_writer_close(trace_writer_t *writer)
+{
+    if (writer->fp != NULL) {
+        fclose(writer->fp);
+        writer->fp = NULL;
+    }
+}
+
+
+// Append one record stamped with the current time. data/length are only used for TRACE_FRAME.
+static inline void trace_write(trace_writer_t *writer, trace_kind_t kind, uint32_t conn_id,
+                               uint8_t type, const uint8_t *data, uint32_t length)
+{
+    if (writer->fp == NULL)
+        return;
+
+    uint64_t now = trace_now_us();
+    fputc(kind, writer->fp);
+    trace_put_varint(writer->fp, now - writer->last_us);
+    trace_put_varint(writer->fp, conn_id);
+    writer->last_us = now;
+
+    if (kind == TRACE_FRAME) {
+        fputc(type, writer->fp);
+        trace_put_varint(writer->fp, length);
+        if (length > 0)
+            fwrite(data, 1, length, writer->fp);
+    }
+}
+
+
+// Check the file header. Returns 0 if fp is a trace this code understands.
+static inline int trace_read_header(FILE *fp)
+{
+    char magic[TRACE_MAGIC_LEN];
+
+    if (fread(magic, 1, TRACE_MAGIC_LEN, fp) != TRACE_MAGIC_LEN || memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0)
+        return -1;
+
+    return fgetc(fp) == TRACE_VERSION ? 0 : -1;
+}
+
+
+// Read the next record. *clock_us carries the running timestamp between calls (start at 0).
+// Returns 1 on success, 0 at clean EOF, -1 on a truncated or malformed record.
+static inline int trace_read_record(FILE *fp, uint64_t *clock_us, trace_record_t *record)
+{
+    uint64_t delta, conn_id, length;
+    int kind = fgetc(fp);
+
+    if (kind == EOF)
+        return 0;
+
+    memset(record, 0, sizeof(*record));
+    if (kind < TRACE_CONNECT || kind > TRACE_CLOSE)
+        return -1;
+    if (trace_get_varint(fp, &delta) != 0 || trace_get_varint(fp, &conn_id) != 0 || conn_id > UINT32_MAX)
+        return -1;
+
+    *clock_us += delta;
+    record->kind = (uint8_t)kind;
+    record->timestamp_us = *clock_us;
+    record->conn_id = (uint32_t)conn_id;
+
+    if (kind == TRACE_FRAME) {
+        int type = fgetc(fp);
+        if (type == EOF || trace_get_varint(fp, &length) != 0 || length > TRACE_MAX_PAYLOAD)
+            return -1;
+
+        record->type = (uint8_t)type;
+        record->length = (uint32_t)length;
+        if (length > 0) {
+            record->payload = malloc(length);
+            if (record->payload == NULL || fread(record->payload, 1, length, fp) != length) {
+                free(record->payload);
+                record->payload = NULL;
+                return -1;
+            }
+        }
+    }
+
+    return 1;
+}
+
+#endif // TRACE_FORMAT_H